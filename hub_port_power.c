@@ -26,6 +26,13 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include <libusb.h>
 
 #if LIBUSB_HELPER==1            // Accommodate old versions of libusb
@@ -44,8 +51,19 @@ enum
     MAX_HUB_PORT_POWER_SET_RETRIES = 3, // # of attempts to set port power
     HUB_DEVICE_CONFIGURATION = 1,   // usb dev configuration to set for hubs
     USB_TIMEOUT = 500,          // USB transaction timeout (ms)
+    USB_MAX_PORT_DEPTH = 7,     // max hub tiers in a USB port path
+    MAX_WATCH_TIMEOUT = 3600,   // max watchdog re-enumeration timeout (s)
+    WATCH_POWER_OFF_MS = 500,   // initial port power-off period for a cycle (ms)
+    WATCH_MAX_BACKOFF_MS = 60000,   // max port power-off period after failures (ms)
+    WATCH_MAX_EVENTS = 16,      // epoll events handled per wakeup
 };
 
+#ifdef LIBUSB_HOTPLUG_MATCH_ANY // hotplug arrived in libusb 1.0.16
+#define HAVE_WATCHDOG 1
+#else
+#define HAVE_WATCHDOG 0
+#endif
+
 const char *progname;
 
 /**************************************************************************/
@@ -63,7 +81,9 @@ void usage(const char *msg)
     }
     fprintf(stderr,
         "usage: %s [-q] -v VendorID -p ProductID [-i Instance ]\n"
-        "               -n PortNum -s PowerSetting\n", progname);
+        "               -n PortNum -s PowerSetting\n"
+        "       %s [-q] -v VendorID -p ProductID [-i Instance ]\n"
+        "               -n PortNum [-n PortNum ...] -w Timeout\n", progname, progname);
     fprintf(stderr,
         "  -v VendorID      USB Vendor ID (base 16), ex. for SMSC, use -v 0424\n");
     fprintf(stderr,
@@ -76,6 +96,14 @@ void usage(const char *msg)
         MAX_HUB_PORT);
     fprintf(stderr,
         "  -s PowerSetting  Port Power setting (0 = turn off, 1 = turn on)\n");
+    fprintf(stderr,
+        "  -w Timeout       Watchdog: power-cycle a watched port when its device\n"
+        "                   disappears or fails to re-enumerate within Timeout\n"
+        "                   seconds (range 1 to %u); -n may be repeated.\n"
+        "                   A USB 3 hub shows up as two hubs, SuperSpeed and\n"
+        "                   High-Speed, on different buses; only devices on the\n"
+        "                   hub selected by -v, -p, -i are watched\n",
+        MAX_WATCH_TIMEOUT);
     fprintf(stderr, "  -q               Quiet; suppress debug output\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "EXAMPLE: if you run run 'lsusb' and see a hub listed like this:\n");
@@ -85,6 +113,11 @@ void usage(const char *msg)
         "Then, to turn off power to port 2 and on for port 3, issue commands:\n");
     fprintf(stderr, "  hub_port_power -v 110a -p 0407 -n 2 -s 0\n");
     fprintf(stderr, "  hub_port_power -v 110a -p 0407 -n 3 -s 1\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr,
+        "To watch ports 2 and 3, power-cycling either port if its device drops off\n"
+        "the bus or is not back within 10 seconds (SIGUSR1 prints statistics):\n");
+    fprintf(stderr, "  hub_port_power -v 110a -p 0407 -n 2 -n 3 -w 10\n");
     exit(1);
 }
 
@@ -110,6 +143,12 @@ void usage(const char *msg)
  * @param pPort_num
  *   pointer to storage location for hub Port Number extracted from command line
  *
+ * @param pPort_mask
+ *   pointer to storage location for bit mask of all hub Port Numbers given
+ *
+ * @param pWatch_timeout
+ *   pointer to storage location for watchdog timeout (s); 0 if not watching
+ *
  * @param pQuiet
  *   pointer to storage location for quiet operation flag
  *
@@ -117,8 +156,8 @@ void usage(const char *msg)
  *   pointer to storage location for port Power Setting extracted from command line
  *****************************************************************************/
 void parse_args(int ac, char **av, uint16_t * pVid, uint16_t * pPid,
-    unsigned int *pHub_instance, unsigned int *pPort_num,
-    unsigned int *pPower_setting, unsigned int *pQuiet)
+    unsigned int *pHub_instance, unsigned int *pPort_num, unsigned int *pPort_mask,
+    unsigned int *pWatch_timeout, unsigned int *pPower_setting, unsigned int *pQuiet)
 {
     progname = *av++;           // save for debug output
     ac--;
@@ -127,6 +166,8 @@ void parse_args(int ac, char **av, uint16_t * pVid, uint16_t * pPid,
     *pPid = 0;
     *pHub_instance = 1;
     *pPort_num = 0;
+    *pPort_mask = 0;
+    *pWatch_timeout = 0;
     *pPower_setting = 2;
     *pQuiet = 0;
 
@@ -161,6 +202,15 @@ void parse_args(int ac, char **av, uint16_t * pVid, uint16_t * pPid,
             {
                 usage("-n takes a numeric argument");
             }
+            *pPort_mask |= 1u << *pPort_num;
+        }
+        else if (*av && strcmp(*av, "-w") == 0)
+        {
+            if (--ac <= 0 || sscanf(*++av, "%u", pWatch_timeout) != 1 ||
+                *pWatch_timeout == 0 || *pWatch_timeout > MAX_WATCH_TIMEOUT)
+            {
+                usage("-w takes a numeric argument");
+            }
         }
         else if (*av && strcmp(*av, "-s") == 0)
         {
@@ -179,7 +229,8 @@ void parse_args(int ac, char **av, uint16_t * pVid, uint16_t * pPid,
             usage("unrecognized command-line argument");
         }
     }
-    if (*pVid == 0 && *pPid == 0 && *pPort_num == 0 && *pPower_setting == 2)
+    if (*pVid == 0 && *pPid == 0 && *pPort_num == 0 && *pPower_setting == 2 &&
+        *pWatch_timeout == 0)
     {
         usage(NULL);
     }
@@ -195,6 +246,22 @@ void parse_args(int ac, char **av, uint16_t * pVid, uint16_t * pPid,
     {
         usage("-n PortNum required");
     }
+    if (*pWatch_timeout != 0)
+    {
+        if (!HAVE_WATCHDOG)
+        {
+            usage("-w requires libusb with hotplug support (1.0.16 or later)");
+        }
+        if (*pPower_setting != 2)
+        {
+            usage("-s and -w may not be used together");
+        }
+        return;
+    }
+    if ((*pPort_mask & (*pPort_mask - 1)) != 0)
+    {
+        usage("-n may only be repeated with -w");
+    }
     if (*pPower_setting == 2)
     {
         usage("-s PowerSetting required");
@@ -400,10 +467,7 @@ void set_hub_configuration(libusb_context * usbctx,
 
 /**************************************************************************/
 /**
- * @brief set or clear the power port feature for the given hub and port
- *
- * @param usbctx
- *   pointer to usb context
+ * @brief issue the hub class SET/CLEAR_FEATURE(PORT_POWER) request, with retries
  *
  * @param hub_device
  *   pointer to hub device handle
@@ -414,17 +478,14 @@ void set_hub_configuration(libusb_context * usbctx,
  * @param port_power_on
  *   If zero, clear port power feature. If non-zero, set port power feature.
  *
- * @param quiet
- *   suppress debug output
+ * @return 0 on success, else the libusb error code of the last attempt
  *****************************************************************************/
-void set_hub_port_power(libusb_context * usbctx,
-    libusb_device_handle * hub_device, int port_num, int port_power_on,
-    unsigned int quiet)
+int hub_port_power_transfer(libusb_device_handle * hub_device, int port_num,
+    int port_power_on)
 {
     int result = 1;
     int numAttempts = 0;
 
-    result = 1;
     while (result != 0 && numAttempts < MAX_HUB_PORT_POWER_SET_RETRIES)
     {
         result = libusb_control_transfer(hub_device, USB_RT_PORT,
@@ -447,15 +508,44 @@ void set_hub_port_power(libusb_context * usbctx,
                 // don't retry the no device error
                 // it doesn't seem likely to work on a second try
                 fprintf(stderr, "%s: device not present\n", progname);
-                break;
+                return result;
             case LIBUSB_ERROR_IO:
                 fprintf(stderr, "%s: IO error in libusb\n", progname);
                 numAttempts++;
                 break;
             default:
-                break;
+                return result;
         }
     }
+    return result;
+}
+
+/**************************************************************************/
+/**
+ * @brief set or clear the power port feature for the given hub and port
+ *
+ * @param usbctx
+ *   pointer to usb context
+ *
+ * @param hub_device
+ *   pointer to hub device handle
+ *
+ * @param port_num
+ *   Number of port to affect (1 - MAX_HUB_PORT)
+ *
+ * @param port_power_on
+ *   If zero, clear port power feature. If non-zero, set port power feature.
+ *
+ * @param quiet
+ *   suppress debug output
+ *****************************************************************************/
+void set_hub_port_power(libusb_context * usbctx,
+    libusb_device_handle * hub_device, int port_num, int port_power_on,
+    unsigned int quiet)
+{
+    int result;
+
+    result = hub_port_power_transfer(hub_device, port_num, port_power_on);
     if (result != 0)
     {
         fprintf(stderr, "%s: failed: %s\n", progname, libusb_error_name(result));
@@ -469,6 +559,943 @@ void set_hub_port_power(libusb_context * usbctx,
     }
 }
 
+#if HAVE_WATCHDOG
+/*
+ * Watchdog mode: a single epoll loop waits on libusb's own file descriptors
+ * (which deliver hotplug events), a timerfd armed for the earliest per-port
+ * deadline, and a signalfd.  Nothing polls; with all devices present and no
+ * libusb timeouts pending the process sleeps in epoll_wait indefinitely.
+ *
+ * Each watched port walks through these states:
+ *
+ *   IDLE -> (first device arrived, adopted as expected device) -> PRESENT
+ *   PRESENT -> (device left) -> LOST -> (Clear-Port-Power) -> POWER_OFF
+ *   POWER_OFF -> (off period expired, Set-Port-Power) -> ENUMERATING
+ *   POWER_OFF -> (expected device arrived anyway, Set-Port-Power) -> PRESENT
+ *   ENUMERATING -> (expected device arrived) -> PRESENT
+ *   ENUMERATING -> (timeout) -> power cycle again, with a doubled off period
+ *   ENUMERATING -> (timeout, but another device present throughout) -> PRESENT,
+ *       with that device adopted as the expected device
+ *
+ * Hotplug callbacks only update port state and deadlines; control transfers
+ * are always issued from the main loop, since libusb forbids synchronous I/O
+ * from within its callbacks.  A synchronous transfer still runs libusb's event
+ * handling while it waits, so the callback can change a port's state in the
+ * middle of watchdog_service_ports; each port carries a generation count,
+ * bumped by the callback, so a stale transition is not applied over it.
+ */
+enum watch_state
+{
+    WATCH_IDLE,                 // no device seen on port yet; nothing to recover
+    WATCH_PRESENT,              // expected device enumerated on port; if a
+                                // deadline is set, port power is to be restored
+    WATCH_LOST,                 // device gone, power cycle due at deadline
+    WATCH_POWER_OFF,            // port power cleared until deadline
+    WATCH_ENUMERATING,          // port power set, waiting for device until deadline
+};
+
+struct watch_port
+{
+    unsigned int watched;       // non-zero if port was given with -n
+    enum watch_state state;
+    uint16_t vid;               // expected device VendorID
+    uint16_t pid;               // expected device ProductID
+    uint16_t new_vid;           // unexpected device now on port; 0 if none
+    uint16_t new_pid;
+    uint64_t deadline;          // monotonic ms of next state action; 0 = none
+    uint64_t lost_at;           // monotonic ms at which device went missing
+    uint64_t present_since;     // monotonic ms at which device last enumerated
+    unsigned int off_ms;        // power-off period of next cycle (backoff)
+    unsigned int num_cycles;    // power cycles issued in current recovery
+    unsigned int generation;    // bumped on every hotplug-driven state change
+    // statistics
+    unsigned int total_losses;
+    unsigned int total_recoveries;
+    unsigned int total_cycles;
+    unsigned int total_timeouts;
+    uint64_t latency_min;       // recovery latency, lost until re-enumerated (ms)
+    uint64_t latency_max;
+    uint64_t latency_sum;
+};
+
+struct watchdog
+{
+    libusb_context *usbctx;
+    libusb_device_handle *hub_device;
+    uint8_t hub_bus;
+    uint8_t hub_path[USB_MAX_PORT_DEPTH];
+    int hub_depth;
+    unsigned int timeout_ms;
+    unsigned int quiet;
+    int epoll_fd;
+    int timer_fd;
+    int signal_fd;
+    struct watch_port port[MAX_HUB_PORT + 1];   // indexed by port number
+};
+
+/**************************************************************************/
+/**
+ * @brief block the signals handled by the watchdog loop
+ *
+ * @details Must be called before libusb_init so that threads started by
+ * libusb inherit the mask, leaving the signals to the watchdog's signalfd.
+ *
+ * @param pMask
+ *   pointer to storage location for the blocked signal set
+ *****************************************************************************/
+void watchdog_block_signals(sigset_t * pMask)
+{
+    sigemptyset(pMask);
+    sigaddset(pMask, SIGINT);
+    sigaddset(pMask, SIGTERM);
+    sigaddset(pMask, SIGUSR1);
+    if (sigprocmask(SIG_BLOCK, pMask, NULL) != 0)
+    {
+        fprintf(stderr, "%s: Could not block signals: %s\n", progname,
+            strerror(errno));
+        exit(1);
+    }
+}
+
+/**************************************************************************/
+/**
+ * @brief read the monotonic clock
+ *
+ * @return current CLOCK_MONOTONIC time in milliseconds
+ *****************************************************************************/
+uint64_t watchdog_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**************************************************************************/
+/**
+ * @brief find which watched hub port, if any, a device is attached to
+ *
+ * @param wd
+ *   pointer to watchdog state
+ *
+ * @param dev
+ *   pointer to usb device
+ *
+ * @details Only the selected hub's bus is matched.  The companion half of a
+ * USB 3 hub is on another bus, and its port numbering is not guaranteed to
+ * match, so devices enumerating there are not seen.
+ *
+ * @return watched port number, or 0 if the device is not directly attached to
+ *   a watched port of the hub
+ *****************************************************************************/
+unsigned int watchdog_port_of(struct watchdog *wd, libusb_device * dev)
+{
+    uint8_t path[USB_MAX_PORT_DEPTH];
+    int depth;
+
+    if (libusb_get_bus_number(dev) != wd->hub_bus)
+    {
+        return 0;
+    }
+    depth = libusb_get_port_numbers(dev, path, sizeof(path));
+    if (depth != wd->hub_depth + 1 || memcmp(path, wd->hub_path, wd->hub_depth) != 0)
+    {
+        return 0;
+    }
+    if (path[wd->hub_depth] > MAX_HUB_PORT || !wd->port[path[wd->hub_depth]].watched)
+    {
+        return 0;
+    }
+    return path[wd->hub_depth];
+}
+
+/**************************************************************************/
+/**
+ * @brief mark a watched port's device as missing and schedule a power cycle
+ *
+ * @details The port's backoff carries over from its previous recovery unless
+ * the device stayed present for at least the re-enumeration timeout, so a
+ * device that keeps dropping off is not cycled at the minimum period forever.
+ *
+ * @param wd
+ *   pointer to watchdog state
+ *
+ * @param port_num
+ *   watched port number
+ *
+ * @param now
+ *   current monotonic time (ms)
+ *****************************************************************************/
+void watchdog_port_lost(struct watchdog *wd, unsigned int port_num, uint64_t now)
+{
+    struct watch_port *wp = &wd->port[port_num];
+
+    wp->state = WATCH_LOST;
+    wp->deadline = now;
+    wp->lost_at = now;
+    wp->new_vid = 0;
+    wp->generation++;
+    if (now - wp->present_since >= wd->timeout_ms)
+    {
+        wp->off_ms = WATCH_POWER_OFF_MS;
+    }
+    wp->num_cycles = 0;
+    wp->total_losses++;
+}
+
+/**************************************************************************/
+/**
+ * @brief libusb hotplug callback; track arrival and departure on watched ports
+ *
+ * @param usbctx
+ *   pointer to usb context
+ *
+ * @param dev
+ *   pointer to usb device that arrived or left
+ *
+ * @param event
+ *   LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED or LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT
+ *
+ * @param user_data
+ *   pointer to watchdog state
+ *
+ * @return 0, to remain registered
+ *****************************************************************************/
+int watchdog_hotplug(libusb_context * usbctx, libusb_device * dev,
+    libusb_hotplug_event event, void *user_data)
+{
+    struct watchdog *wd = user_data;
+    struct watch_port *wp;
+    struct libusb_device_descriptor devDesc;
+    unsigned int port_num;
+    uint64_t now;
+    uint64_t latency;
+
+    port_num = watchdog_port_of(wd, dev);
+    if (port_num == 0)
+    {
+        return 0;
+    }
+    wp = &wd->port[port_num];
+    now = watchdog_now_ms();
+
+    if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT)
+    {
+        // departures caused by our own power cycling are expected
+        if (wp->state == WATCH_PRESENT)
+        {
+            fprintf(stderr, "%s: port %u: device %04x:%04x left the bus\n",
+                progname, port_num, wp->vid, wp->pid);
+            watchdog_port_lost(wd, port_num, now);
+        }
+        else
+        {
+            wp->new_vid = 0;
+        }
+        return 0;
+    }
+
+    if (wp->state == WATCH_PRESENT)
+    {
+        return 0;
+    }
+    if (libusb_get_device_descriptor(dev, &devDesc) != 0)
+    {
+        return 0;
+    }
+    if (wp->state == WATCH_IDLE)
+    {
+        wp->vid = devDesc.idVendor;
+        wp->pid = devDesc.idProduct;
+        wp->state = WATCH_PRESENT;
+        wp->present_since = now;
+        wp->generation++;
+        if (!wd->quiet)
+        {
+            printf("%s: port %u: watching device %04x:%04x\n", progname,
+                port_num, wp->vid, wp->pid);
+        }
+        return 0;
+    }
+    if (devDesc.idVendor != wp->vid || devDesc.idProduct != wp->pid)
+    {
+        // a device the user swapped in; adopted if still here at the timeout
+        fprintf(stderr, "%s: port %u: unexpected device %04x:%04x (expected %04x:%04x)\n",
+            progname, port_num, devDesc.idVendor, devDesc.idProduct, wp->vid, wp->pid);
+        wp->new_vid = devDesc.idVendor;
+        wp->new_pid = devDesc.idProduct;
+        return 0;
+    }
+
+    // a hub with ganged or unswitched port power may not have cut power
+    // at all; the device is back, so restore port power right away
+    wp->deadline = (wp->state == WATCH_POWER_OFF) ? now : 0;
+    wp->state = WATCH_PRESENT;
+    wp->present_since = now;
+    wp->new_vid = 0;
+    wp->generation++;
+    latency = now - wp->lost_at;
+    if (wp->total_recoveries == 0 || latency < wp->latency_min)
+    {
+        wp->latency_min = latency;
+    }
+    if (latency > wp->latency_max)
+    {
+        wp->latency_max = latency;
+    }
+    wp->latency_sum += latency;
+    wp->total_recoveries++;
+    if (!wd->quiet)
+    {
+        printf("%s: port %u: device %04x:%04x recovered in %llu ms"
+            " after %u power cycle(s)\n",
+            progname, port_num, wp->vid, wp->pid, (unsigned long long)latency,
+            wp->num_cycles);
+    }
+    return 0;
+}
+
+/**************************************************************************/
+/**
+ * @brief record the devices currently attached to the watched ports
+ *
+ * @details A watched port with no device attached is left idle until a device
+ * first arrives on it; that device then becomes the expected device.
+ *
+ * @param wd
+ *   pointer to watchdog state
+ *****************************************************************************/
+void watchdog_scan_ports(struct watchdog *wd)
+{
+    libusb_device **deviceList;
+    struct libusb_device_descriptor devDesc;
+    unsigned int port_num;
+    int numDevices;
+    int deviceNum;
+
+    numDevices = libusb_get_device_list(wd->usbctx, &deviceList);
+    if (numDevices < 0)
+    {
+        fprintf(stderr, "%s: Could not get USB device list: %s\n", progname,
+            libusb_error_name(numDevices));
+        numDevices = 0;
+        deviceList = NULL;
+    }
+    for (deviceNum = 0; deviceNum < numDevices; deviceNum++)
+    {
+        port_num = watchdog_port_of(wd, deviceList[deviceNum]);
+        if (port_num != 0 &&
+            libusb_get_device_descriptor(deviceList[deviceNum], &devDesc) == 0)
+        {
+            wd->port[port_num].vid = devDesc.idVendor;
+            wd->port[port_num].pid = devDesc.idProduct;
+            wd->port[port_num].state = WATCH_PRESENT;
+            wd->port[port_num].present_since = watchdog_now_ms();
+        }
+    }
+    if (deviceList != NULL)
+    {
+        libusb_free_device_list(deviceList, 1);
+    }
+
+    for (port_num = 1; port_num <= MAX_HUB_PORT; port_num++)
+    {
+        if (!wd->port[port_num].watched)
+        {
+            continue;
+        }
+        if (wd->port[port_num].state == WATCH_PRESENT)
+        {
+            if (!wd->quiet)
+            {
+                printf("%s: port %u: watching device %04x:%04x\n", progname,
+                    port_num, wd->port[port_num].vid, wd->port[port_num].pid);
+            }
+        }
+        else if (!wd->quiet)
+        {
+            printf("%s: port %u: no device present, waiting for one to arrive\n",
+                progname, port_num);
+        }
+    }
+}
+
+/**************************************************************************/
+/**
+ * @brief reconcile a port power transfer with a state change made during it
+ *
+ * @details The hotplug callback ran while the transfer waited and has already
+ * moved the port on; keep its state, but make sure a port it marked present
+ * ends up powered.
+ *
+ * @param wd
+ *   pointer to watchdog state
+ *
+ * @param port_num
+ *   watched port number
+ *
+ * @param port_power_on
+ *   power setting the transfer requested
+ *
+ * @param result
+ *   result of the transfer
+ *****************************************************************************/
+void watchdog_transfer_raced(struct watchdog *wd, unsigned int port_num,
+    int port_power_on, int result)
+{
+    struct watch_port *wp = &wd->port[port_num];
+
+    if (wp->state != WATCH_PRESENT)
+    {
+        return;
+    }
+    if (result == 0 && port_power_on)
+    {
+        wp->deadline = 0;       // power is already on
+    }
+    else if (result == 0 || port_power_on)
+    {
+        wp->deadline = watchdog_now_ms();   // restore port power
+    }
+}
+
+/**************************************************************************/
+/**
+ * @brief perform the state actions of all ports whose deadline has passed
+ *
+ * @param wd
+ *   pointer to watchdog state
+ *
+ * @return 0, or LIBUSB_ERROR_NO_DEVICE if the hub itself has gone away
+ *****************************************************************************/
+int watchdog_service_ports(struct watchdog *wd)
+{
+    struct watch_port *wp;
+    unsigned int port_num;
+    unsigned int generation;
+    uint64_t now = watchdog_now_ms();
+    int result;
+
+    for (port_num = 1; port_num <= MAX_HUB_PORT; port_num++)
+    {
+        wp = &wd->port[port_num];
+        if (!wp->watched || wp->deadline == 0 || wp->deadline > now)
+        {
+            continue;
+        }
+        result = 0;
+        generation = wp->generation;
+        switch (wp->state)
+        {
+            case WATCH_ENUMERATING:
+                if (wp->new_vid != 0)
+                {
+                    // don't keep cutting power to a device the user plugged in
+                    if (!wd->quiet)
+                    {
+                        printf("%s: port %u: watching device %04x:%04x"
+                            " in place of %04x:%04x\n",
+                            progname, port_num, wp->new_vid, wp->new_pid, wp->vid,
+                            wp->pid);
+                    }
+                    wp->vid = wp->new_vid;
+                    wp->pid = wp->new_pid;
+                    wp->new_vid = 0;
+                    wp->state = WATCH_PRESENT;
+                    wp->deadline = 0;
+                    wp->present_since = now;
+                    wp->off_ms = WATCH_POWER_OFF_MS;
+                    break;
+                }
+                wp->total_timeouts++;
+                fprintf(stderr, "%s: port %u: device did not re-enumerate within %u s\n",
+                    progname, port_num, wd->timeout_ms / 1000);
+                // fall through
+            case WATCH_LOST:
+                result = hub_port_power_transfer(wd->hub_device, port_num, 0);
+                if (wp->generation != generation)
+                {
+                    watchdog_transfer_raced(wd, port_num, 0, result);
+                    break;
+                }
+                if (result == 0)
+                {
+                    wp->state = WATCH_POWER_OFF;
+                    wp->num_cycles++;
+                    wp->total_cycles++;
+                    if (!wd->quiet)
+                    {
+                        printf("%s: port %u: power off for %u ms\n", progname,
+                            port_num, wp->off_ms);
+                    }
+                }
+                else
+                {
+                    fprintf(stderr, "%s: port %u: Clear-Port-Power failed: %s\n",
+                        progname, port_num, libusb_error_name(result));
+                    wp->state = WATCH_LOST;
+                }
+                wp->deadline = now + wp->off_ms;
+                wp->off_ms *= 2;
+                if (wp->off_ms > WATCH_MAX_BACKOFF_MS)
+                {
+                    wp->off_ms = WATCH_MAX_BACKOFF_MS;
+                }
+                break;
+            case WATCH_POWER_OFF:
+                result = hub_port_power_transfer(wd->hub_device, port_num, 1);
+                if (wp->generation != generation)
+                {
+                    watchdog_transfer_raced(wd, port_num, 1, result);
+                    break;
+                }
+                if (result == 0)
+                {
+                    wp->state = WATCH_ENUMERATING;
+                    wp->deadline = now + wd->timeout_ms;
+                    if (!wd->quiet)
+                    {
+                        printf("%s: port %u: power on\n", progname, port_num);
+                    }
+                }
+                else
+                {
+                    fprintf(stderr, "%s: port %u: Set-Port-Power failed: %s\n",
+                        progname, port_num, libusb_error_name(result));
+                    wp->state = WATCH_LOST;
+                    wp->deadline = now + wp->off_ms;
+                }
+                break;
+            case WATCH_PRESENT:
+                result = hub_port_power_transfer(wd->hub_device, port_num, 1);
+                if (result != 0)
+                {
+                    fprintf(stderr, "%s: port %u: Set-Port-Power failed: %s\n",
+                        progname, port_num, libusb_error_name(result));
+                }
+                if (wp->generation == generation)
+                {
+                    wp->deadline = 0;
+                }
+                break;
+            case WATCH_IDLE:
+                wp->deadline = 0;
+                break;
+        }
+        if (result == LIBUSB_ERROR_NO_DEVICE)
+        {
+            // the hub handle is stale; let a supervisor restart us
+            return result;
+        }
+    }
+    return 0;
+}
+
+/**************************************************************************/
+/**
+ * @brief turn power back on for every port the watchdog may have left off
+ *
+ * @details Called on shutdown so that stopping the watchdog mid-recovery does
+ * not leave a device unpowered.
+ *
+ * @param wd
+ *   pointer to watchdog state
+ *****************************************************************************/
+void watchdog_restore_power(struct watchdog *wd)
+{
+    struct watch_port *wp;
+    unsigned int port_num;
+    int result;
+
+    for (port_num = 1; port_num <= MAX_HUB_PORT; port_num++)
+    {
+        wp = &wd->port[port_num];
+        if (!wp->watched || wp->state == WATCH_IDLE ||
+            (wp->state == WATCH_PRESENT && wp->deadline == 0))
+        {
+            continue;
+        }
+        result = hub_port_power_transfer(wd->hub_device, port_num, 1);
+        if (result != 0)
+        {
+            fprintf(stderr, "%s: port %u: Set-Port-Power failed: %s\n",
+                progname, port_num, libusb_error_name(result));
+        }
+        else if (!wd->quiet)
+        {
+            printf("%s: port %u: power on\n", progname, port_num);
+        }
+    }
+}
+
+/**************************************************************************/
+/**
+ * @brief arm the timerfd for the earliest pending port deadline
+ *
+ * @param wd
+ *   pointer to watchdog state
+ *****************************************************************************/
+void watchdog_arm_timer(struct watchdog *wd)
+{
+    struct itimerspec its;
+    uint64_t deadline = 0;
+    unsigned int port_num;
+
+    for (port_num = 1; port_num <= MAX_HUB_PORT; port_num++)
+    {
+        if (wd->port[port_num].watched && wd->port[port_num].deadline != 0 &&
+            (deadline == 0 || wd->port[port_num].deadline < deadline))
+        {
+            deadline = wd->port[port_num].deadline;
+        }
+    }
+
+    // an all-zero it_value disarms the timer
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = deadline / 1000;
+    its.it_value.tv_nsec = (deadline % 1000) * 1000000;
+    if (timerfd_settime(wd->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) != 0)
+    {
+        fprintf(stderr, "%s: Could not arm watchdog timer: %s\n", progname,
+            strerror(errno));
+    }
+}
+
+/**************************************************************************/
+/**
+ * @brief print per-port recovery statistics
+ *
+ * @param wd
+ *   pointer to watchdog state
+ *****************************************************************************/
+void watchdog_print_stats(struct watchdog *wd)
+{
+    struct watch_port *wp;
+    unsigned int port_num;
+
+    for (port_num = 1; port_num <= MAX_HUB_PORT; port_num++)
+    {
+        wp = &wd->port[port_num];
+        if (!wp->watched)
+        {
+            continue;
+        }
+        printf("%s: port %u: losses %u, recoveries %u, power cycles %u, timeouts %u",
+            progname, port_num, wp->total_losses, wp->total_recoveries,
+            wp->total_cycles, wp->total_timeouts);
+        if (wp->total_recoveries > 0)
+        {
+            printf(", recovery latency min/avg/max %llu/%llu/%llu ms",
+                (unsigned long long)wp->latency_min,
+                (unsigned long long)(wp->latency_sum / wp->total_recoveries),
+                (unsigned long long)wp->latency_max);
+        }
+        printf("\n");
+    }
+}
+
+/**************************************************************************/
+/**
+ * @brief add a file descriptor to the watchdog epoll set
+ *
+ * @param epoll_fd
+ *   epoll instance file descriptor
+ *
+ * @param fd
+ *   file descriptor to add
+ *
+ * @param events
+ *   poll(2) events of interest
+ *
+ * @return 0 on success, -1 on failure (reported)
+ *****************************************************************************/
+int watchdog_epoll_add(int epoll_fd, int fd, short events)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = ((events & POLLIN) ? EPOLLIN : 0) | ((events & POLLOUT) ? EPOLLOUT : 0);
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0 &&
+        (errno != EEXIST || epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) != 0))
+    {
+        fprintf(stderr, "%s: Could not add fd %d to epoll set: %s\n", progname, fd,
+            strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**************************************************************************/
+/**
+ * @brief libusb callback; a new libusb file descriptor must be monitored
+ *
+ * @param fd
+ *   file descriptor added by libusb
+ *
+ * @param events
+ *   poll(2) events of interest
+ *
+ * @param user_data
+ *   pointer to watchdog state
+ *****************************************************************************/
+void watchdog_pollfd_added(int fd, short events, void *user_data)
+{
+    struct watchdog *wd = user_data;
+
+    watchdog_epoll_add(wd->epoll_fd, fd, events);
+}
+
+/**************************************************************************/
+/**
+ * @brief libusb callback; a libusb file descriptor is no longer monitored
+ *
+ * @param fd
+ *   file descriptor removed by libusb
+ *
+ * @param user_data
+ *   pointer to watchdog state
+ *****************************************************************************/
+void watchdog_pollfd_removed(int fd, void *user_data)
+{
+    struct watchdog *wd = user_data;
+
+    epoll_ctl(wd->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+/**************************************************************************/
+/**
+ * @brief create the epoll set and register libusb, timer and signal sources
+ *
+ * @param wd
+ *   pointer to watchdog state
+ *
+ * @param pSigmask
+ *   pointer to the set of signals blocked by watchdog_block_signals
+ *****************************************************************************/
+void watchdog_init_events(struct watchdog *wd, const sigset_t * pSigmask)
+{
+    const struct libusb_pollfd **pollfds;
+    int i;
+
+    wd->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wd->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    wd->signal_fd = signalfd(-1, pSigmask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (wd->epoll_fd < 0 || wd->timer_fd < 0 || wd->signal_fd < 0)
+    {
+        fprintf(stderr, "%s: Could not create watchdog event sources: %s\n",
+            progname, strerror(errno));
+        libusb_exit(wd->usbctx);    // close USB library
+        exit(1);
+    }
+    // signals are blocked; without these the loop could not be stopped or timed
+    if (watchdog_epoll_add(wd->epoll_fd, wd->timer_fd, POLLIN) != 0 ||
+        watchdog_epoll_add(wd->epoll_fd, wd->signal_fd, POLLIN) != 0)
+    {
+        libusb_exit(wd->usbctx);    // close USB library
+        exit(1);
+    }
+
+    // register notifiers first so no fd added in between is missed
+    libusb_set_pollfd_notifiers(wd->usbctx, watchdog_pollfd_added,
+        watchdog_pollfd_removed, wd);
+    pollfds = libusb_get_pollfds(wd->usbctx);
+    if (pollfds == NULL)
+    {
+        fprintf(stderr, "%s: Could not get libusb file descriptors\n", progname);
+        libusb_exit(wd->usbctx);    // close USB library
+        exit(1);
+    }
+    for (i = 0; pollfds[i] != NULL; i++)
+    {
+        watchdog_epoll_add(wd->epoll_fd, pollfds[i]->fd, pollfds[i]->events);
+    }
+#if defined(LIBUSB_API_VERSION) && LIBUSB_API_VERSION >= 0x01000104
+    libusb_free_pollfds(pollfds);
+#else
+    free(pollfds);
+#endif
+}
+
+/**************************************************************************/
+/**
+ * @brief run the watchdog event loop until SIGINT or SIGTERM
+ *
+ * @param usbctx
+ *   pointer to usb context
+ *
+ * @param hub_device
+ *   pointer to hub device handle
+ *
+ * @param port_mask
+ *   bit mask of hub port numbers to watch
+ *
+ * @param watch_timeout
+ *   seconds to wait for a device to re-enumerate after its port is powered on
+ *
+ * @param pSigmask
+ *   pointer to the set of signals blocked by watchdog_block_signals
+ *
+ * @param quiet
+ *   suppress debug output
+ *
+ * @return process exit status; non-zero if the hub disappeared or the event
+ *   loop failed
+ *****************************************************************************/
+int run_watchdog(libusb_context * usbctx, libusb_device_handle * hub_device,
+    unsigned int port_mask, unsigned int watch_timeout, const sigset_t * pSigmask,
+    unsigned int quiet)
+{
+    static struct watchdog wd;
+    struct epoll_event events[WATCH_MAX_EVENTS];
+    struct signalfd_siginfo siginfo;
+    struct timeval tv;
+    libusb_hotplug_callback_handle hotplug_handle;
+    libusb_device *hub;
+    unsigned int port_num;
+    uint64_t expirations;
+    int libusb_ready;
+    int running = 1;
+    int hub_present = 1;
+    int status = 0;
+    int timeout;
+    int numEvents;
+    int i;
+    int result;
+
+    if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG))
+    {
+        fprintf(stderr, "%s: libusb hotplug is not supported on this platform\n",
+            progname);
+        libusb_exit(usbctx);    // close USB library
+        exit(1);
+    }
+
+    // line-buffer event messages for logs and pipes
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    wd.usbctx = usbctx;
+    wd.hub_device = hub_device;
+    wd.timeout_ms = watch_timeout * 1000;
+    wd.quiet = quiet;
+    hub = libusb_get_device(hub_device);
+    wd.hub_bus = libusb_get_bus_number(hub);
+    wd.hub_depth = libusb_get_port_numbers(hub, wd.hub_path, sizeof(wd.hub_path));
+    if (wd.hub_depth < 0 || wd.hub_depth >= USB_MAX_PORT_DEPTH)
+    {
+        fprintf(stderr, "%s: Could not get hub port path: %s\n", progname,
+            libusb_error_name(wd.hub_depth));
+        libusb_exit(usbctx);    // close USB library
+        exit(1);
+    }
+    for (port_num = 1; port_num <= MAX_HUB_PORT; port_num++)
+    {
+        wd.port[port_num].watched = (port_mask >> port_num) & 1;
+        wd.port[port_num].state = WATCH_IDLE;
+        wd.port[port_num].off_ms = WATCH_POWER_OFF_MS;
+    }
+
+    watchdog_init_events(&wd, pSigmask);
+
+    // register before scanning so that no departure goes unseen
+    result = libusb_hotplug_register_callback(usbctx,
+        LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT, 0,
+        LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY,
+        watchdog_hotplug, &wd, &hotplug_handle);
+    if (result != 0)
+    {
+        fprintf(stderr, "%s: Could not register hotplug callback: %s\n", progname,
+            libusb_error_name(result));
+        libusb_exit(usbctx);    // close USB library
+        exit(1);
+    }
+    watchdog_scan_ports(&wd);
+
+    while (running)
+    {
+        if (watchdog_service_ports(&wd) != 0)
+        {
+            fprintf(stderr, "%s: hub disappeared, exiting\n", progname);
+            watchdog_print_stats(&wd);
+            hub_present = 0;
+            status = 1;
+            break;
+        }
+        watchdog_arm_timer(&wd);
+
+        // sleep indefinitely unless libusb needs to be woken for a timeout
+        timeout = -1;
+        if (!libusb_pollfds_handle_timeouts(usbctx) &&
+            libusb_get_next_timeout(usbctx, &tv) == 1)
+        {
+            timeout = tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000;
+        }
+
+        numEvents = epoll_wait(wd.epoll_fd, events, WATCH_MAX_EVENTS, timeout);
+        if (numEvents < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fprintf(stderr, "%s: epoll_wait failed: %s\n", progname, strerror(errno));
+            status = 1;
+            break;
+        }
+
+        libusb_ready = (numEvents == 0);
+        for (i = 0; i < numEvents; i++)
+        {
+            if (events[i].data.fd == wd.timer_fd)
+            {
+                // drain expiration count; deadlines are rechecked at loop top
+                if (read(wd.timer_fd, &expirations, sizeof(expirations)) < 0 &&
+                    errno != EAGAIN)
+                {
+                    fprintf(stderr, "%s: timerfd read failed: %s\n", progname,
+                        strerror(errno));
+                }
+            }
+            else if (events[i].data.fd == wd.signal_fd)
+            {
+                if (read(wd.signal_fd, &siginfo, sizeof(siginfo)) != sizeof(siginfo))
+                {
+                    continue;
+                }
+                watchdog_print_stats(&wd);
+                if (siginfo.ssi_signo != SIGUSR1)
+                {
+                    running = 0;
+                }
+            }
+            else
+            {
+                libusb_ready = 1;
+            }
+        }
+        if (libusb_ready && running)
+        {
+            // dispatches hotplug callbacks without blocking
+            memset(&tv, 0, sizeof(tv));
+            libusb_handle_events_timeout_completed(usbctx, &tv, NULL);
+        }
+    }
+
+    libusb_hotplug_deregister_callback(usbctx, hotplug_handle);
+    libusb_set_pollfd_notifiers(usbctx, NULL, NULL, NULL);
+    close(wd.signal_fd);
+    close(wd.timer_fd);
+    close(wd.epoll_fd);
+    if (hub_present)
+    {
+        watchdog_restore_power(&wd);
+    }
+    libusb_close(hub_device);
+    libusb_exit(usbctx);        // close USB library
+    return status;
+}
+#endif
+
 /**************************************************************************/
 /**
  * @brief main routine
@@ -489,16 +1516,35 @@ int main(int ac, char **av)
     uint16_t pid;
     unsigned int hub_instance;
     unsigned int port_num;
+    unsigned int port_mask;
+    unsigned int watch_timeout;
     unsigned int power_setting;
     unsigned int quiet;
+#if HAVE_WATCHDOG
+    sigset_t sigmask;
+#endif
 
-    parse_args(ac, av, &vid, &pid, &hub_instance, &port_num, &power_setting, &quiet);
+    parse_args(ac, av, &vid, &pid, &hub_instance, &port_num, &port_mask,
+        &watch_timeout, &power_setting, &quiet);
+#if HAVE_WATCHDOG
+    if (watch_timeout != 0)
+    {
+        watchdog_block_signals(&sigmask);
+    }
+#endif
     init_libusb(&usbctx);
     libusb_set_debug(usbctx, LIBUSB_DEBUG_LEVEL);
     print_libusb_version(usbctx, quiet);
     find_hub_device(usbctx, vid, pid, hub_instance, &hub_device, quiet);
     set_hub_configuration(usbctx, hub_device, HUB_DEVICE_CONFIGURATION, quiet);
     // note: for hub control transfers, interface need not be set
+#if HAVE_WATCHDOG
+    if (watch_timeout != 0)
+    {
+        exit(run_watchdog(usbctx, hub_device, port_mask, watch_timeout, &sigmask,
+                quiet));
+    }
+#endif
     set_hub_port_power(usbctx, hub_device, port_num, power_setting, quiet);
 
     exit(0);